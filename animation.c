@@ -0,0 +1,263 @@
+#include "animation.h"
+
+#include <string.h>
+
+static void timespec_add_ms(struct timespec *t, int ms) {
+  t->tv_sec += ms / 1000;
+  t->tv_nsec += (long)(ms % 1000) * 1000000;
+  if (t->tv_nsec >= 1000000000) {
+    t->tv_sec++;
+    t->tv_nsec -= 1000000000;
+  }
+}
+
+static int timespec_before(const struct timespec *a, const struct timespec *b) {
+  return a->tv_sec < b->tv_sec ||
+         (a->tv_sec == b->tv_sec && a->tv_nsec < b->tv_nsec);
+}
+
+/* Scales the decoder canvas onto a screen sized surface */
+static void animation_render(Animation *a, cairo_surface_t *canvas,
+                             cairo_surface_t *target) {
+  cairo_t *ctx = cairo_create(target);
+
+  cairo_set_source_rgb(ctx, 0, 0, 0);
+  cairo_paint(ctx);
+
+  cairo_translate(ctx, a->transformation.translate_x,
+                  a->transformation.translate_y);
+  cairo_scale(ctx, a->transformation.scale_x, a->transformation.scale_y);
+  cairo_set_source_surface(ctx, canvas, 0, 0);
+  cairo_paint(ctx);
+
+  cairo_destroy(ctx);
+  cairo_surface_flush(target);
+}
+
+static void *animation_decode(void *data) {
+  Animation *a = data;
+  FrameDecoder *decoder = a->decoder;
+  cairo_surface_t *canvas = cairo_image_surface_create_for_data(
+      (unsigned char *)decoder->canvas, CAIRO_FORMAT_ARGB32, decoder->width,
+      decoder->height, decoder->width * (int)sizeof(uint32_t));
+
+  /* frames decoded since the animation started over */
+  int frames = 0;
+
+  pthread_mutex_lock(&a->mutex);
+  while (1) {
+    while (a->running &&
+           (a->filled == ANIMATION_RING_SIZE || !a->visible)) {
+      pthread_cond_wait(&a->cond, &a->mutex);
+    }
+    if (!a->running) {
+      break;
+    }
+    /* the slot is outside of what the event loop may read */
+    int slot = a->write;
+    pthread_mutex_unlock(&a->mutex);
+
+    int delay_ms;
+    int ret = frame_decoder_next(decoder, &delay_ms);
+    if (ret == 1 && frames > 1) {
+      frame_decoder_rewind(decoder);
+      frames = 0;
+      ret = frame_decoder_next(decoder, &delay_ms);
+    }
+    if (ret == 0) {
+      frames++;
+      cairo_surface_mark_dirty(canvas);
+      animation_render(a, canvas, a->ring[slot].surface);
+    }
+
+    pthread_mutex_lock(&a->mutex);
+    if (ret) {
+      /* a still image or a corrupt file, keep showing what we have */
+      a->finished = 1;
+    } else {
+      a->ring[slot].delay_ms = delay_ms;
+      a->write = (slot + 1) % ANIMATION_RING_SIZE;
+      a->filled++;
+    }
+
+    /* a starved event loop also has to learn that nothing is coming */
+    if (a->starved) {
+      a->starved = 0;
+      pthread_mutex_unlock(&a->mutex);
+      a->frame_ready();
+      pthread_mutex_lock(&a->mutex);
+    }
+    if (a->finished) {
+      break;
+    }
+  }
+  pthread_mutex_unlock(&a->mutex);
+
+  cairo_surface_destroy(canvas);
+  return NULL;
+}
+
+/* Joins the decoder thread once it has nothing left to deliver and frees all
+ * surfaces but the one on screen, a still image does not need the ring */
+static void animation_release(Animation *a) {
+  pthread_join(a->thread, NULL);
+  for (int i = 0; i < ANIMATION_RING_SIZE; i++) {
+    if (i != a->read) {
+      cairo_surface_destroy(a->ring[i].surface);
+      a->ring[i].surface = NULL;
+    }
+  }
+}
+
+int animation_init(Animation *animation, FrameDecoder *decoder, int width,
+                   int height, ScaleTranslate transformation, int visible,
+                   void (*frame_ready)(void)) {
+  memset(animation, 0, sizeof(Animation));
+  animation->decoder = decoder;
+  animation->width = width;
+  animation->height = height;
+  animation->transformation = transformation;
+  animation->frame_ready = frame_ready;
+  animation->visible = visible;
+  animation->running = 1;
+  animation->starved = 1;
+
+  for (int i = 0; i < ANIMATION_RING_SIZE; i++) {
+    animation->ring[i].surface =
+        cairo_image_surface_create(CAIRO_FORMAT_ARGB32, width, height);
+    if (cairo_surface_status(animation->ring[i].surface) !=
+        CAIRO_STATUS_SUCCESS) {
+      for (int j = 0; j <= i; j++) {
+        cairo_surface_destroy(animation->ring[j].surface);
+      }
+      return 1;
+    }
+  }
+
+  pthread_mutex_init(&animation->mutex, NULL);
+  pthread_cond_init(&animation->cond, NULL);
+
+  if (pthread_create(&animation->thread, NULL, animation_decode, animation)) {
+    animation->running = 0;
+    animation_destroy(animation);
+    return 1;
+  }
+
+  return 0;
+}
+
+int animation_destroy(Animation *animation) {
+  if (animation->running) {
+    pthread_mutex_lock(&animation->mutex);
+    animation->running = 0;
+    pthread_cond_signal(&animation->cond);
+    pthread_mutex_unlock(&animation->mutex);
+    pthread_join(animation->thread, NULL);
+  }
+
+  for (int i = 0; i < ANIMATION_RING_SIZE; i++) {
+    cairo_surface_destroy(animation->ring[i].surface);
+  }
+  pthread_mutex_destroy(&animation->mutex);
+  pthread_cond_destroy(&animation->cond);
+  return 0;
+}
+
+cairo_surface_t *animation_current_frame(Animation *animation) {
+  cairo_surface_t *ret = NULL;
+  pthread_mutex_lock(&animation->mutex);
+  if (animation->displayed) {
+    ret = animation->ring[animation->read].surface;
+  }
+  pthread_mutex_unlock(&animation->mutex);
+  return ret;
+}
+
+int animation_failed(Animation *animation) {
+  pthread_mutex_lock(&animation->mutex);
+  int ret = animation->finished && !animation->filled;
+  pthread_mutex_unlock(&animation->mutex);
+  return ret;
+}
+
+int animation_advance(Animation *a) {
+  int ret = 0;
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  pthread_mutex_lock(&a->mutex);
+  if (!a->visible) {
+    // paused
+  } else if (!a->displayed) {
+    if (a->filled) {
+      a->displayed = 1;
+      a->deadline = now;
+      timespec_add_ms(&a->deadline, a->ring[a->read].delay_ms);
+      ret = 1;
+    } else {
+      a->starved = 1;
+    }
+  } else if (timespec_before(&now, &a->deadline)) {
+    // not due yet
+  } else if (a->filled < 2) {
+    if (!a->finished) {
+      a->starved = 1;
+    }
+  } else {
+    a->read = (a->read + 1) % ANIMATION_RING_SIZE;
+    a->filled--;
+    timespec_add_ms(&a->deadline, a->ring[a->read].delay_ms);
+    /* don't try to catch up after falling behind */
+    if (timespec_before(&a->deadline, &now)) {
+      a->deadline = now;
+      timespec_add_ms(&a->deadline, a->ring[a->read].delay_ms);
+    }
+    pthread_cond_signal(&a->cond);
+    ret = 1;
+  }
+
+  int release = a->running && a->finished && a->displayed && a->filled == 1;
+  if (release) {
+    a->running = 0;
+  }
+  pthread_mutex_unlock(&a->mutex);
+
+  if (release) {
+    animation_release(a);
+  }
+  return ret;
+}
+
+int animation_timeout(Animation *a, struct timeval *timeout) {
+  int ret = 0;
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  pthread_mutex_lock(&a->mutex);
+  if (!a->visible || a->starved ||
+      (a->finished && (!a->filled || (a->displayed && a->filled < 2)))) {
+    ret = 1;
+  } else if (!a->displayed || timespec_before(&a->deadline, &now)) {
+    timeout->tv_sec = 0;
+    timeout->tv_usec = 0;
+  } else {
+    long usec = (a->deadline.tv_sec - now.tv_sec) * 1000000 +
+                (a->deadline.tv_nsec - now.tv_nsec) / 1000;
+    timeout->tv_sec = usec / 1000000;
+    timeout->tv_usec = usec % 1000000;
+  }
+  pthread_mutex_unlock(&a->mutex);
+
+  return ret;
+}
+
+void animation_set_visible(Animation *animation, int visible) {
+  pthread_mutex_lock(&animation->mutex);
+  if (visible && !animation->visible) {
+    /* continue with the next frame instead of catching up */
+    clock_gettime(CLOCK_MONOTONIC, &animation->deadline);
+  }
+  animation->visible = visible;
+  pthread_cond_signal(&animation->cond);
+  pthread_mutex_unlock(&animation->mutex);
+}
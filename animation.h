@@ -0,0 +1,74 @@
+#ifndef ANIMATION_H
+#define ANIMATION_H
+
+#include <cairo/cairo.h>
+
+#include <pthread.h>
+#include <time.h>
+
+#include <sys/time.h>
+
+#include "frame_decoder.h"
+#include "scale_translate.h"
+
+/* number of pre-scaled, screen sized frames decoded ahead of time */
+#define ANIMATION_RING_SIZE 3
+
+typedef struct {
+  cairo_surface_t *surface;
+  int delay_ms;
+} AnimationFrame;
+
+/* Streams the frames of a FrameDecoder from a decoder thread into a ring of
+ * screen sized surfaces, which the event loop presents on their own timing.
+ * The decoder thread pauses while the ring is full or the window is not
+ * visible. Once the decoder runs out of frames and only one is left, the
+ * thread is joined and the rest of the ring is freed. */
+typedef struct {
+  FrameDecoder *decoder;
+  int width;
+  int height;
+  ScaleTranslate transformation;
+  AnimationFrame ring[ANIMATION_RING_SIZE];
+  /* ring[read] is on screen once displayed is set, filled includes it */
+  int read;
+  int write;
+  int filled;
+  int displayed;
+  int visible;
+  /* cleared when the decoder thread was asked to stop, or was joined after the
+   * last frame went on screen */
+  int running;
+  /* set when the decoder has no more frames to deliver */
+  int finished;
+  /* set when the event loop waits for the decoder */
+  int starved;
+  struct timespec deadline;
+  /* called from the decoder thread when a starved event loop has to wake */
+  void (*frame_ready)(void);
+  pthread_t thread;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+} Animation;
+
+int animation_init(Animation *animation, FrameDecoder *decoder, int width,
+                   int height, ScaleTranslate transformation, int visible,
+                   void (*frame_ready)(void));
+int animation_destroy(Animation *animation);
+
+/* Returns the frame on screen, or NULL before the first one was decoded */
+cairo_surface_t *animation_current_frame(Animation *animation);
+
+/* Returns 1 if the decoder stopped before it delivered the first frame */
+int animation_failed(Animation *animation);
+
+/* Moves on to the next frame if it is due, returns 1 if the frame changed */
+int animation_advance(Animation *animation);
+
+/* Sets the time until the next frame is due. Returns 1 if there is nothing
+ * to wait for. */
+int animation_timeout(Animation *animation, struct timeval *timeout);
+
+void animation_set_visible(Animation *animation, int visible);
+
+#endif
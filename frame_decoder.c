@@ -0,0 +1,785 @@
+#include "frame_decoder.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <png.h>
+#include <zlib.h>
+
+/* largest canvas accepted, to keep width * height * 4 far from overflowing */
+#define MAX_DIMENSION 32768
+
+#define GIF_MAX_CODES 4096
+
+static const unsigned char png_signature[8] = {0x89, 'P',  'N',  'G',
+                                               '\r', '\n', 0x1a, '\n'};
+
+static const unsigned char png_iend[12] = {0,   0,   0,   0,   'I',  'E',
+                                           'N', 'D', 0xae, 0x42, 0x60, 0x82};
+
+static uint16_t read_le16(const unsigned char *p) {
+  return (uint16_t)(p[0] | p[1] << 8);
+}
+
+static uint32_t read_be32(const unsigned char *p) {
+  return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 |
+         (uint32_t)p[3];
+}
+
+static void write_be32(unsigned char *p, uint32_t value) {
+  p[0] = (unsigned char)(value >> 24);
+  p[1] = (unsigned char)(value >> 16);
+  p[2] = (unsigned char)(value >> 8);
+  p[3] = (unsigned char)value;
+}
+
+static int ensure_buffer(unsigned char **buffer, size_t *buffer_size,
+                         size_t size) {
+  if (size <= *buffer_size) {
+    return 0;
+  }
+  if (size < *buffer_size * 2) {
+    size = *buffer_size * 2;
+  }
+  unsigned char *new = realloc(*buffer, size);
+  if (!new) {
+    return 1;
+  }
+  *buffer = new;
+  *buffer_size = size;
+  return 0;
+}
+
+/* Clips a frame rectangle to the canvas, returns 1 if nothing is left */
+static int clip_rect(const FrameDecoder *d, int *x, int *y, int *width,
+                     int *height) {
+  if (*x + *width > d->width) {
+    *width = d->width - *x;
+  }
+  if (*y + *height > d->height) {
+    *height = d->height - *y;
+  }
+  return *width <= 0 || *height <= 0;
+}
+
+static void apply_dispose(FrameDecoder *d) {
+  int x = d->dispose_x;
+  int y = d->dispose_y;
+  int width = d->dispose_width;
+  int height = d->dispose_height;
+
+  if (d->dispose == FRAME_DISPOSE_NONE ||
+      clip_rect(d, &x, &y, &width, &height)) {
+    d->dispose = FRAME_DISPOSE_NONE;
+    return;
+  }
+
+  for (int row = y; row < y + height; row++) {
+    uint32_t *dst = d->canvas + (size_t)row * (size_t)d->width + x;
+    if (d->dispose == FRAME_DISPOSE_BACKGROUND) {
+      memset(dst, 0, (size_t)width * sizeof(uint32_t));
+    } else {
+      memcpy(dst, d->previous + (dst - d->canvas),
+             (size_t)width * sizeof(uint32_t));
+    }
+  }
+  d->dispose = FRAME_DISPOSE_NONE;
+}
+
+/* Remembers how the frame that is about to be drawn has to be disposed.
+ * Returns 1 if there is no memory to keep the canvas around. */
+static int set_dispose(FrameDecoder *d, frame_dispose_t dispose, int x, int y,
+                       int width, int height) {
+  size_t pixel_count = (size_t)d->width * (size_t)d->height;
+  if (dispose == FRAME_DISPOSE_PREVIOUS) {
+    /* most files never dispose to the previous frame */
+    if (!d->previous) {
+      d->previous = malloc(pixel_count * sizeof(uint32_t));
+      if (!d->previous) {
+        return 1;
+      }
+    }
+    memcpy(d->previous, d->canvas, pixel_count * sizeof(uint32_t));
+  }
+  d->dispose = dispose;
+  d->dispose_x = x;
+  d->dispose_y = y;
+  d->dispose_width = width;
+  d->dispose_height = height;
+  return 0;
+}
+
+/* GIF */
+
+static void gif_read_palette(const unsigned char *p, int size,
+                             uint32_t *palette) {
+  for (int i = 0; i < 256; i++) {
+    palette[i] = 0xff000000;
+    if (i < size) {
+      palette[i] |= (uint32_t)p[3 * i] << 16 | (uint32_t)p[3 * i + 1] << 8 |
+                    (uint32_t)p[3 * i + 2];
+    }
+  }
+}
+
+static int gif_open(FrameDecoder *d) {
+  if (d->size < 13 || (memcmp(d->data, "GIF87a", 6) &&
+                       memcmp(d->data, "GIF89a", 6))) {
+    return 1;
+  }
+
+  d->type = FRAME_DECODER_GIF;
+  d->width = read_le16(d->data + 6);
+  d->height = read_le16(d->data + 8);
+  if (d->width > MAX_DIMENSION || d->height > MAX_DIMENSION) {
+    return 1;
+  }
+  unsigned char flags = d->data[10];
+  d->offset = 13;
+
+  /* global color table */
+  gif_read_palette(d->data, 0, d->gif_palette);
+  if (flags & 0x80) {
+    int size = 2 << (flags & 7);
+    if (d->offset + 3 * (size_t)size > d->size) {
+      return 1;
+    }
+    gif_read_palette(d->data + d->offset, size, d->gif_palette);
+    d->offset += 3 * (size_t)size;
+  }
+
+  d->first_frame_offset = d->offset;
+  return 0;
+}
+
+static int gif_skip_sub_blocks(FrameDecoder *d) {
+  while (d->offset < d->size) {
+    size_t length = d->data[d->offset++];
+    if (length == 0) {
+      return 0;
+    }
+    d->offset += length;
+  }
+  return -1;
+}
+
+/* Concatenates the data sub-blocks of an image into the scratch buffer */
+static int gif_read_sub_blocks(FrameDecoder *d, size_t *length) {
+  *length = 0;
+  while (d->offset < d->size) {
+    size_t block_length = d->data[d->offset++];
+    if (block_length == 0) {
+      return 0;
+    }
+    if (d->offset + block_length > d->size ||
+        ensure_buffer(&d->scratch, &d->scratch_size, *length + block_length)) {
+      return -1;
+    }
+    memcpy(d->scratch + *length, d->data + d->offset, block_length);
+    *length += block_length;
+    d->offset += block_length;
+  }
+  return -1;
+}
+
+static int gif_decode_lzw(const unsigned char *in, size_t in_length,
+                          int min_code_size, unsigned char *out,
+                          size_t out_length) {
+  uint16_t prefix[GIF_MAX_CODES];
+  unsigned char suffix[GIF_MAX_CODES];
+  unsigned char stack[GIF_MAX_CODES + 1];
+
+  if (min_code_size < 2 || min_code_size > 11) {
+    return -1;
+  }
+
+  const int clear = 1 << min_code_size;
+  const int end = clear + 1;
+  int next = clear + 2;
+  int code_size = min_code_size + 1;
+
+  for (int i = 0; i < clear; i++) {
+    prefix[i] = 0;
+    suffix[i] = (unsigned char)i;
+  }
+
+  uint32_t bits = 0;
+  int bit_count = 0;
+  size_t in_pos = 0;
+  size_t written = 0;
+  int previous = -1;
+  unsigned char first = 0;
+
+  while (written < out_length) {
+    while (bit_count < code_size) {
+      if (in_pos >= in_length) {
+        /* truncated image, pad with the first color */
+        memset(out + written, 0, out_length - written);
+        return 0;
+      }
+      bits |= (uint32_t)in[in_pos++] << bit_count;
+      bit_count += 8;
+    }
+    int code = (int)(bits & ((1u << code_size) - 1));
+    bits >>= code_size;
+    bit_count -= code_size;
+
+    if (code == clear) {
+      next = clear + 2;
+      code_size = min_code_size + 1;
+      previous = -1;
+      continue;
+    }
+    if (code == end) {
+      break;
+    }
+    if (previous == -1) {
+      if (code >= clear) {
+        return -1;
+      }
+      out[written++] = (unsigned char)code;
+      first = (unsigned char)code;
+      previous = code;
+      continue;
+    }
+
+    const int in_code = code;
+    size_t depth = 0;
+    if (code >= next) {
+      /* the code that is just being defined */
+      if (code > next) {
+        return -1;
+      }
+      stack[depth++] = first;
+      code = previous;
+    }
+    while (code >= clear) {
+      stack[depth++] = suffix[code];
+      code = prefix[code];
+    }
+    first = (unsigned char)code;
+    stack[depth++] = first;
+
+    while (depth && written < out_length) {
+      out[written++] = stack[--depth];
+    }
+
+    if (next < GIF_MAX_CODES) {
+      prefix[next] = (uint16_t)previous;
+      suffix[next] = first;
+      next++;
+      if (next == 1 << code_size && code_size < 12) {
+        code_size++;
+      }
+    }
+    previous = in_code;
+  }
+
+  memset(out + written, 0, out_length - written);
+  return 0;
+}
+
+/* Maps the n-th decoded row of an interlaced image to its position */
+static int gif_interlaced_row(int row, int height) {
+  int pass = (height + 7) / 8;
+  if (row < pass) {
+    return row * 8;
+  }
+  row -= pass;
+  pass = (height + 3) / 8;
+  if (row < pass) {
+    return row * 8 + 4;
+  }
+  row -= pass;
+  pass = (height + 1) / 4;
+  if (row < pass) {
+    return row * 4 + 2;
+  }
+  row -= pass;
+  return row * 2 + 1;
+}
+
+static int gif_read_image(FrameDecoder *d, frame_dispose_t dispose,
+                          int transparent) {
+  if (d->offset + 9 > d->size) {
+    return -1;
+  }
+  const unsigned char *p = d->data + d->offset;
+  int x = read_le16(p);
+  int y = read_le16(p + 2);
+  int width = read_le16(p + 4);
+  int height = read_le16(p + 6);
+  unsigned char flags = p[8];
+  d->offset += 9;
+
+  uint32_t local_palette[256];
+  const uint32_t *palette = d->gif_palette;
+  if (flags & 0x80) {
+    int size = 2 << (flags & 7);
+    if (d->offset + 3 * (size_t)size > d->size) {
+      return -1;
+    }
+    gif_read_palette(d->data + d->offset, size, local_palette);
+    palette = local_palette;
+    d->offset += 3 * (size_t)size;
+  }
+
+  if (d->offset >= d->size) {
+    return -1;
+  }
+  int min_code_size = d->data[d->offset++];
+
+  size_t length;
+  if (gif_read_sub_blocks(d, &length)) {
+    return -1;
+  }
+
+  /* frames reaching past the logical screen are clipped to it, like browsers
+   * do, and rows below it are not decoded unless interlacing mixes them in */
+  const int interlaced = flags & 0x40;
+  int visible_x = x;
+  int visible_y = y;
+  int visible_width = width;
+  int visible_height = height;
+  int hidden = clip_rect(d, &visible_x, &visible_y, &visible_width,
+                         &visible_height);
+  size_t pixel_count =
+      (size_t)width * (size_t)(interlaced ? height : visible_height);
+  if (!hidden && pixel_count > (size_t)MAX_DIMENSION * MAX_DIMENSION) {
+    return -1;
+  }
+  if (!hidden &&
+      (ensure_buffer(&d->frame_buffer, &d->frame_buffer_size, pixel_count) ||
+       gif_decode_lzw(d->scratch, length, min_code_size, d->frame_buffer,
+                      pixel_count))) {
+    return -1;
+  }
+
+  apply_dispose(d);
+  if (set_dispose(d, dispose, x, y, width, height)) {
+    return -1;
+  }
+  if (hidden) {
+    return 0;
+  }
+
+  const int rows = interlaced ? height : visible_height;
+  for (int row = 0; row < rows; row++) {
+    int canvas_y = y + (interlaced ? gif_interlaced_row(row, height) : row);
+    if (canvas_y >= d->height) {
+      continue;
+    }
+    const unsigned char *src = d->frame_buffer + (size_t)row * (size_t)width;
+    uint32_t *dst = d->canvas + (size_t)canvas_y * (size_t)d->width;
+    for (int col = 0; col < visible_width; col++) {
+      if (src[col] != transparent) {
+        dst[x + col] = palette[src[col]];
+      }
+    }
+  }
+  return 0;
+}
+
+static int gif_next(FrameDecoder *d, int *delay_ms) {
+  frame_dispose_t dispose = FRAME_DISPOSE_NONE;
+  int transparent = -1;
+  int delay = 0;
+
+  while (d->offset < d->size) {
+    unsigned char block = d->data[d->offset++];
+
+    if (block == 0x3b) {
+      /* trailer */
+      return 1;
+    }
+
+    if (block == 0x21) {
+      /* extension, only the graphic control extension is of interest */
+      if (d->offset >= d->size) {
+        return -1;
+      }
+      unsigned char label = d->data[d->offset++];
+      if (label == 0xf9 && d->offset + 5 <= d->size &&
+          d->data[d->offset] >= 4) {
+        const unsigned char *p = d->data + d->offset + 1;
+        switch ((p[0] >> 2) & 7) {
+        case 2:
+          dispose = FRAME_DISPOSE_BACKGROUND;
+          break;
+        case 3:
+          dispose = FRAME_DISPOSE_PREVIOUS;
+          break;
+        default:
+          dispose = FRAME_DISPOSE_NONE;
+        }
+        delay = read_le16(p + 1) * 10;
+        transparent = (p[0] & 1) ? p[3] : -1;
+      }
+      if (gif_skip_sub_blocks(d)) {
+        return -1;
+      }
+      continue;
+    }
+
+    if (block != 0x2c) {
+      return -1;
+    }
+
+    if (gif_read_image(d, dispose, transparent)) {
+      return -1;
+    }
+    /* browsers treat very short delays as 100ms, animations rely on that */
+    *delay_ms = delay <= 10 ? 100 : delay;
+    return 0;
+  }
+
+  /* missing trailer */
+  return 1;
+}
+
+/* APNG */
+
+/* Validates the chunk at offset, returns 1 if it is out of bounds */
+static int apng_chunk(const FrameDecoder *d, size_t offset, uint32_t *length,
+                      const unsigned char **type) {
+  if (offset + 12 > d->size) {
+    return 1;
+  }
+  *length = read_be32(d->data + offset);
+  if (*length > d->size - offset - 12) {
+    return 1;
+  }
+  *type = d->data + offset + 4;
+  return 0;
+}
+
+static int apng_open(FrameDecoder *d) {
+  uint32_t length;
+  const unsigned char *type;
+
+  if (d->size < 8 || memcmp(d->data, png_signature, 8) ||
+      apng_chunk(d, 8, &length, &type) || memcmp(type, "IHDR", 4) ||
+      length != 13) {
+    return 1;
+  }
+
+  d->type = FRAME_DECODER_APNG;
+  uint32_t width = read_be32(d->data + 16);
+  uint32_t height = read_be32(d->data + 20);
+  if (width > MAX_DIMENSION || height > MAX_DIMENSION) {
+    return 1;
+  }
+  d->width = (int)width;
+  d->height = (int)height;
+
+  /* everything up to the first frame, the animation control chunk is
+   * mandatory for animated images */
+  int animated = 0;
+  size_t offset = 8 + 12 + 13;
+  d->apng_header.offset = offset;
+  while (1) {
+    if (apng_chunk(d, offset, &length, &type)) {
+      return 1;
+    }
+    if (!memcmp(type, "IDAT", 4) || !memcmp(type, "fcTL", 4)) {
+      break;
+    }
+    if (!memcmp(type, "acTL", 4)) {
+      animated = 1;
+    }
+    offset += 12 + (size_t)length;
+  }
+  d->apng_header.length = offset - d->apng_header.offset;
+  d->first_frame_offset = d->offset = offset;
+
+  return !animated;
+}
+
+static uint32_t premultiply(const unsigned char *rgba) {
+  uint32_t a = rgba[3];
+  uint32_t r = (rgba[0] * a + 127) / 255;
+  uint32_t g = (rgba[1] * a + 127) / 255;
+  uint32_t b = (rgba[2] * a + 127) / 255;
+  return a << 24 | r << 16 | g << 8 | b;
+}
+
+static uint32_t blend_over(uint32_t src, uint32_t dst) {
+  uint32_t inverse_alpha = 255 - (src >> 24);
+  uint32_t ret = 0;
+  for (int shift = 0; shift < 32; shift += 8) {
+    uint32_t s = (src >> shift) & 0xff;
+    uint32_t t = (dst >> shift) & 0xff;
+    ret |= (s + (t * inverse_alpha + 127) / 255) << shift;
+  }
+  return ret;
+}
+
+/* Rebuilds a standalone PNG from the header chunks and the image data of one
+ * frame in the scratch buffer, returns its size or 0 on error */
+static size_t apng_build_frame(FrameDecoder *d, size_t data_start,
+                               size_t data_end, uint32_t width,
+                               uint32_t height) {
+  uint32_t length;
+  const unsigned char *type;
+
+  /* the image data of all chunks is merged into a single IDAT */
+  size_t data_length = 0;
+  for (size_t offset = data_start; offset < data_end;
+       offset += 12 + (size_t)length) {
+    if (apng_chunk(d, offset, &length, &type)) {
+      return 0;
+    }
+    if (!memcmp(type, "IDAT", 4)) {
+      data_length += length;
+    } else if (!memcmp(type, "fdAT", 4)) {
+      if (length < 4) {
+        return 0;
+      }
+      data_length += length - 4;
+    }
+  }
+  if (data_length > UINT32_MAX) {
+    return 0;
+  }
+
+  size_t size = 8 + 25 + d->apng_header.length + 12 + data_length + 12;
+  if (ensure_buffer(&d->scratch, &d->scratch_size, size)) {
+    return 0;
+  }
+  unsigned char *p = d->scratch;
+
+  memcpy(p, d->data, 8 + 25);
+  write_be32(p + 16, width);
+  write_be32(p + 20, height);
+  write_be32(p + 29, (uint32_t)crc32(0, p + 12, 17));
+  p += 8 + 25;
+
+  /* copy the header chunks, without the animation control */
+  const size_t header_end = d->apng_header.offset + d->apng_header.length;
+  for (size_t offset = d->apng_header.offset; offset < header_end;
+       offset += 12 + (size_t)length) {
+    if (apng_chunk(d, offset, &length, &type)) {
+      return 0;
+    }
+    if (memcmp(type, "acTL", 4)) {
+      memcpy(p, d->data + offset, 12 + (size_t)length);
+      p += 12 + (size_t)length;
+    }
+  }
+
+  unsigned char *idat = p;
+  write_be32(p, (uint32_t)data_length);
+  memcpy(p + 4, "IDAT", 4);
+  p += 8;
+  for (size_t offset = data_start; offset < data_end;
+       offset += 12 + (size_t)length) {
+    if (apng_chunk(d, offset, &length, &type)) {
+      return 0;
+    }
+    if (!memcmp(type, "IDAT", 4)) {
+      memcpy(p, type + 4, length);
+      p += length;
+    } else if (!memcmp(type, "fdAT", 4)) {
+      /* skip the sequence number */
+      memcpy(p, type + 8, length - 4);
+      p += length - 4;
+    }
+  }
+  write_be32(p, (uint32_t)crc32(0, idat + 4, (uInt)(data_length + 4)));
+  p += 4;
+
+  memcpy(p, png_iend, sizeof(png_iend));
+  p += sizeof(png_iend);
+
+  return (size_t)(p - d->scratch);
+}
+
+static int apng_next(FrameDecoder *d, int *delay_ms) {
+  uint32_t length;
+  const unsigned char *type;
+
+  /* find the next frame control chunk */
+  while (1) {
+    if (apng_chunk(d, d->offset, &length, &type)) {
+      return -1;
+    }
+    if (!memcmp(type, "IEND", 4)) {
+      return 1;
+    }
+    if (!memcmp(type, "fcTL", 4)) {
+      break;
+    }
+    d->offset += 12 + (size_t)length;
+  }
+  if (length < 26) {
+    return -1;
+  }
+  const unsigned char *control = type + 4;
+  uint32_t width = read_be32(control + 4);
+  uint32_t height = read_be32(control + 8);
+  uint32_t x = read_be32(control + 12);
+  uint32_t y = read_be32(control + 16);
+  uint16_t delay_num = (uint16_t)(control[20] << 8 | control[21]);
+  uint16_t delay_den = (uint16_t)(control[22] << 8 | control[23]);
+  unsigned char dispose_op = control[24];
+  unsigned char blend_op = control[25];
+  d->offset += 12 + (size_t)length;
+
+  if (width == 0 || height == 0 || x > (uint32_t)d->width ||
+      y > (uint32_t)d->height || width > (uint32_t)d->width - x ||
+      height > (uint32_t)d->height - y) {
+    return -1;
+  }
+
+  /* the image data runs up to the next frame */
+  size_t data_start = d->offset;
+  while (1) {
+    if (apng_chunk(d, d->offset, &length, &type)) {
+      return -1;
+    }
+    if (!memcmp(type, "fcTL", 4) || !memcmp(type, "IEND", 4)) {
+      break;
+    }
+    d->offset += 12 + (size_t)length;
+  }
+
+  size_t size = apng_build_frame(d, data_start, d->offset, width, height);
+  if (!size) {
+    return -1;
+  }
+
+  png_image image;
+  memset(&image, 0, sizeof(image));
+  image.version = PNG_IMAGE_VERSION;
+  if (!png_image_begin_read_from_memory(&image, d->scratch, size)) {
+    return -1;
+  }
+  image.format = PNG_FORMAT_RGBA;
+  if (ensure_buffer(&d->frame_buffer, &d->frame_buffer_size,
+                    PNG_IMAGE_SIZE(image)) ||
+      !png_image_finish_read(&image, NULL, d->frame_buffer, 0, NULL)) {
+    png_image_free(&image);
+    return -1;
+  }
+
+  frame_dispose_t dispose = FRAME_DISPOSE_NONE;
+  if (dispose_op == 1) {
+    dispose = FRAME_DISPOSE_BACKGROUND;
+  } else if (dispose_op == 2) {
+    /* the first frame has nothing to go back to */
+    dispose =
+        d->frame_index ? FRAME_DISPOSE_PREVIOUS : FRAME_DISPOSE_BACKGROUND;
+  }
+
+  apply_dispose(d);
+  if (set_dispose(d, dispose, (int)x, (int)y, (int)width, (int)height)) {
+    return -1;
+  }
+
+  for (uint32_t row = 0; row < height; row++) {
+    const unsigned char *src = d->frame_buffer + (size_t)row * width * 4;
+    uint32_t *dst = d->canvas + (size_t)(y + row) * (size_t)d->width + x;
+    for (uint32_t col = 0; col < width; col++) {
+      uint32_t pixel = premultiply(src + 4 * col);
+      dst[col] = blend_op ? blend_over(pixel, dst[col]) : pixel;
+    }
+  }
+
+  int delay = delay_num * 1000 / (delay_den ? delay_den : 100);
+  *delay_ms = delay < 10 ? 10 : delay;
+  return 0;
+}
+
+int frame_decoder_open(FrameDecoder *decoder, const char *path) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return 1;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) || st.st_size <= 0) {
+    close(fd);
+    return 1;
+  }
+
+  size_t size = (size_t)st.st_size;
+  void *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    return 1;
+  }
+
+  if (frame_decoder_open_memory(decoder, data, size)) {
+    munmap(data, size);
+    return 1;
+  }
+  decoder->mapped_size = size;
+  return 0;
+}
+
+int frame_decoder_open_memory(FrameDecoder *decoder, const unsigned char *data,
+                              size_t size) {
+  memset(decoder, 0, sizeof(FrameDecoder));
+  decoder->data = data;
+  decoder->size = size;
+
+  if (gif_open(decoder) && apng_open(decoder)) {
+    return 1;
+  }
+
+  if (decoder->width <= 0 || decoder->height <= 0) {
+    return 1;
+  }
+
+  size_t pixel_count = (size_t)decoder->width * (size_t)decoder->height;
+  decoder->canvas = calloc(pixel_count, sizeof(uint32_t));
+  if (!decoder->canvas) {
+    frame_decoder_destroy(decoder);
+    return 1;
+  }
+
+  return 0;
+}
+
+int frame_decoder_destroy(FrameDecoder *decoder) {
+  free(decoder->canvas);
+  free(decoder->previous);
+  free(decoder->scratch);
+  free(decoder->frame_buffer);
+  if (decoder->mapped_size) {
+    munmap((void *)decoder->data, decoder->mapped_size);
+  }
+  memset(decoder, 0, sizeof(FrameDecoder));
+  return 0;
+}
+
+int frame_decoder_next(FrameDecoder *decoder, int *delay_ms) {
+  int ret;
+  switch (decoder->type) {
+  case FRAME_DECODER_GIF:
+    ret = gif_next(decoder, delay_ms);
+    break;
+  case FRAME_DECODER_APNG:
+    ret = apng_next(decoder, delay_ms);
+    break;
+  default:
+    ret = -1;
+  }
+  if (ret == 0) {
+    decoder->frame_index++;
+  }
+  return ret;
+}
+
+int frame_decoder_rewind(FrameDecoder *decoder) {
+  decoder->offset = decoder->first_frame_offset;
+  decoder->frame_index = 0;
+  decoder->dispose = FRAME_DISPOSE_NONE;
+  memset(decoder->canvas, 0,
+         (size_t)decoder->width * (size_t)decoder->height * sizeof(uint32_t));
+  return 0;
+}
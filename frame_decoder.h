@@ -0,0 +1,71 @@
+#ifndef FRAME_DECODER_H
+#define FRAME_DECODER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum _frame_decoder_type {
+  FRAME_DECODER_GIF,
+  FRAME_DECODER_APNG
+} frame_decoder_type_t;
+
+typedef enum _frame_dispose {
+  FRAME_DISPOSE_NONE,
+  FRAME_DISPOSE_BACKGROUND,
+  FRAME_DISPOSE_PREVIOUS
+} frame_dispose_t;
+
+typedef struct {
+  size_t offset;
+  size_t length;
+} FrameDecoderSpan;
+
+/* Decodes the frames of an animated GIF or PNG one after another into a
+ * single canvas, so only the compressed file and one frame worth of pixels
+ * are held in memory. */
+typedef struct {
+  frame_decoder_type_t type;
+  const unsigned char *data;
+  size_t size;
+  /* non zero if data is a mapping owned by the decoder */
+  size_t mapped_size;
+  /* read position of the next frame, and of the first one for rewinding */
+  size_t offset;
+  size_t first_frame_offset;
+  int frame_index;
+  int width;
+  int height;
+  /* composited current frame, premultiplied ARGB32 with a stride of
+   * width * 4 */
+  uint32_t *canvas;
+  /* copy of the canvas for FRAME_DISPOSE_PREVIOUS, allocated on first use */
+  uint32_t *previous;
+  /* disposal of the last frame, applied before the next one is drawn */
+  frame_dispose_t dispose;
+  int dispose_x;
+  int dispose_y;
+  int dispose_width;
+  int dispose_height;
+  /* scratch memory reused between frames */
+  unsigned char *scratch;
+  size_t scratch_size;
+  unsigned char *frame_buffer;
+  size_t frame_buffer_size;
+  /* GIF: global color table */
+  uint32_t gif_palette[256];
+  /* APNG: chunks between IHDR and the image data that every frame needs */
+  FrameDecoderSpan apng_header;
+} FrameDecoder;
+
+/* Returns 0 if the file is an animated GIF or PNG, 1 otherwise. */
+int frame_decoder_open(FrameDecoder *decoder, const char *path);
+int frame_decoder_open_memory(FrameDecoder *decoder, const unsigned char *data,
+                              size_t size);
+int frame_decoder_destroy(FrameDecoder *decoder);
+
+/* Decodes the next frame into decoder->canvas. Returns 0 on success, 1 at the
+ * end of the animation and -1 if the file is corrupt. */
+int frame_decoder_next(FrameDecoder *decoder, int *delay_ms);
+int frame_decoder_rewind(FrameDecoder *decoder);
+
+#endif
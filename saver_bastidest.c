@@ -5,16 +5,21 @@
 #include <xcb/xproto.h>
 
 #include <assert.h>
+#include <fcntl.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
+#include <unistd.h>
 
 #include <sys/select.h>
 #include <sys/time.h>
 
+#include "animation.h"
+#include "frame_decoder.h"
 #include "string_set.h"
 #include "scale_translate.h"
+#include "text_style.h"
 
 #ifdef DEBUG
 #define DEBUG_PRINT(...) printf("D: " __VA_ARGS__)
@@ -38,6 +43,22 @@ typedef struct {
   int width;
 } ScreenSize;
 
+/* Estimated extents of the clock text, used to pick the region of the
+ * background that the text style is derived from */
+#define TEXT_REGION_WIDTH 640
+#define TEXT_REGION_ASCENT 160
+#define TEXT_REGION_DESCENT 20
+
+typedef struct {
+  /* either a still image, or a decoder and the animation streaming from it */
+  cairo_surface_t *image;
+  FrameDecoder *decoder;
+  Animation *animation;
+  /* screen size the text style was computed for, zero if not yet analyzed */
+  ScreenSize analyzed_size;
+  TextStyle text_style;
+} CachedBackground;
+
 typedef struct {
   char *image_path;
   StringSet *image_cache;
@@ -48,10 +69,25 @@ typedef struct {
   float time_offset_left;
   float time_offset_bottom;
   scale_type_t scale_type;
+  TextStyle text_style;
+  /* animation of the current background, if any */
+  Animation *animation;
+  /* whether the window can be seen, animations pause otherwise */
+  int visible;
+  void (*frame_ready)(void);
+  /* screen sized surface every paint is drawn to before it is copied to the
+   * window, so half drawn frames are never shown */
+  cairo_surface_t *staging_surface;
 } DrawData;
 
 X11Context x11_context;
 
+/* Other threads wake the event loop through this pipe instead of talking to
+ * the X server, so they never pull events off the connection */
+#define WAKE_TICK 't'
+#define WAKE_FRAME 'f'
+int wake_pipe[2];
+
 static void cairo_close_x11_surface(cairo_surface_t *sfc) {
   cairo_surface_destroy(sfc);
 }
@@ -103,7 +139,8 @@ static int init_x11_context(X11Context *c, unsigned int parent_window_id) {
 
   /* Setup the event mask */
   c->event_mask = XCB_EVENT_MASK_BUTTON_PRESS | XCB_EVENT_MASK_EXPOSURE |
-                  XCB_EVENT_MASK_STRUCTURE_NOTIFY;
+                  XCB_EVENT_MASK_STRUCTURE_NOTIFY |
+                  XCB_EVENT_MASK_VISIBILITY_CHANGE;
 
   /* Create the window */
   c->window = xcb_generate_id(c->connection);
@@ -124,6 +161,8 @@ static int init_x11_context(X11Context *c, unsigned int parent_window_id) {
   /* Flush all events */
   xcb_flush(c->connection);
 
+  c->fd = xcb_get_file_descriptor(c->connection);
+
   return 0;
 }
 
@@ -142,8 +181,9 @@ static int create_x11_surface(cairo_surface_t **sfc, X11Context *c,
   return 0;
 }
 
-static int cairo_scale_context(cairo_t *ctx, int image_width, int image_height,
-                               DrawData *draw_data) {
+static ScaleTranslate compute_transformation(int image_width,
+                                             int image_height,
+                                             DrawData *draw_data) {
   ScaleTranslate transformation;
 
   switch (draw_data->scale_type) {
@@ -165,35 +205,194 @@ static int cairo_scale_context(cairo_t *ctx, int image_width, int image_height,
     break;
   }
 
+  return transformation;
+}
+
+static int cairo_scale_context(cairo_t *ctx, int image_width, int image_height,
+                               DrawData *draw_data) {
+  ScaleTranslate transformation =
+      compute_transformation(image_width, image_height, draw_data);
+
   cairo_translate(ctx, transformation.translate_x, transformation.translate_y);
   cairo_scale(ctx, transformation.scale_x, transformation.scale_y);
 
   return 0;
 }
 
-static int cairo_paint_background(cairo_t *ctx, DrawData *draw_data) {
-  cairo_surface_t *image;
-  if (string_set_get(draw_data->image_cache, draw_data->image_path,
-                     (void **)(&image))) {
-    // cache miss
-    image = cairo_image_surface_create_from_png(draw_data->image_path);
-    string_set_add(draw_data->image_cache, draw_data->image_path, image);
+/* Starts streaming the frames of the decoder, scaled to the current screen
+ * size. The transformation is the same for all frames. */
+static int start_animation(CachedBackground *background, DrawData *draw_data) {
+  ScaleTranslate transformation = compute_transformation(
+      background->decoder->width, background->decoder->height, draw_data);
+
+  if (animation_init(background->animation, background->decoder,
+                     draw_data->screen_size.width,
+                     draw_data->screen_size.height, transformation,
+                     draw_data->visible, draw_data->frame_ready)) {
+    free(background->animation);
+    background->animation = 0;
+    return 1;
+  }
+  return 0;
+}
+
+static void destroy_background(CachedBackground *background) {
+  if (background->animation) {
+    animation_destroy(background->animation);
+    free(background->animation);
   }
+  if (background->decoder) {
+    frame_decoder_destroy(background->decoder);
+    free(background->decoder);
+  }
+  if (background->image) {
+    cairo_surface_destroy(background->image);
+  }
+  free(background);
+}
+
+static cairo_surface_t *load_image(const char *path) {
+  cairo_surface_t *image = cairo_image_surface_create_from_png(path);
 
   cairo_status_t status = cairo_surface_status(image);
   if (status == CAIRO_STATUS_NO_MEMORY ||
       status == CAIRO_STATUS_FILE_NOT_FOUND ||
       status == CAIRO_STATUS_READ_ERROR || status == CAIRO_STATUS_PNG_ERROR) {
     cairo_surface_destroy(image);
+    return 0;
+  }
+  return image;
+}
+
+static CachedBackground *load_background(DrawData *draw_data) {
+  CachedBackground *background = malloc(sizeof(CachedBackground));
+  background->image = 0;
+  background->decoder = 0;
+  background->animation = 0;
+  background->analyzed_size.width = 0;
+  background->analyzed_size.height = 0;
+  background->text_style = text_style_default();
+
+  FrameDecoder *decoder = malloc(sizeof(FrameDecoder));
+  if (!frame_decoder_open(decoder, draw_data->image_path)) {
+    background->decoder = decoder;
+    background->animation = malloc(sizeof(Animation));
+    if (start_animation(background, draw_data)) {
+      destroy_background(background);
+      return 0;
+    }
+    return background;
+  }
+  free(decoder);
+
+  background->image = load_image(draw_data->image_path);
+  if (!background->image) {
+    free(background);
+    return 0;
+  }
+  return background;
+}
+
+/* Drops an animation that could not decode a single frame. An APNG may still
+ * show its default image through cairo, returns 1 if nothing is left. */
+static int fall_back_to_image(CachedBackground *background,
+                              DrawData *draw_data) {
+  frame_decoder_type_t type = background->decoder->type;
+
+  if (background->animation) {
+    animation_destroy(background->animation);
+    free(background->animation);
+    background->animation = 0;
+  }
+  frame_decoder_destroy(background->decoder);
+  free(background->decoder);
+  background->decoder = 0;
+  draw_data->animation = 0;
+
+  if (type == FRAME_DECODER_APNG) {
+    background->image = load_image(draw_data->image_path);
+  }
+  if (!background->image) {
     return 1;
   }
+  fprintf(stderr, "unable to open image '%s' as an animation\n",
+          draw_data->image_path);
+  return 0;
+}
 
-  // fill the background with a plain black color to prevent old images from
-  // showing
+/* fill the background with a plain black color to prevent old images from
+ * showing */
+static void cairo_paint_black(cairo_t *ctx, DrawData *draw_data) {
   cairo_rectangle(ctx, 0, 0, draw_data->screen_size.width,
                   draw_data->screen_size.height);
   cairo_set_source_rgb(ctx, 0, 0, 0);
   cairo_fill(ctx);
+}
+
+static int cairo_paint_animation(cairo_t *ctx, DrawData *draw_data,
+                                 CachedBackground *background) {
+  if (!background->animation) {
+    return 1;
+  }
+
+  /* frames are pre-scaled, start over if the screen size changed */
+  if (background->animation->width != draw_data->screen_size.width ||
+      background->animation->height != draw_data->screen_size.height) {
+    animation_destroy(background->animation);
+    frame_decoder_rewind(background->decoder);
+    if (start_animation(background, draw_data)) {
+      return 1;
+    }
+  }
+
+  if (animation_failed(background->animation)) {
+    return 1;
+  }
+
+  /* frames cover the whole screen, nothing to show before the first one was
+   * decoded */
+  cairo_surface_t *frame = animation_current_frame(background->animation);
+  if (frame) {
+    cairo_save(ctx);
+    cairo_set_operator(ctx, CAIRO_OPERATOR_SOURCE);
+    cairo_set_source_surface(ctx, frame, 0, 0);
+    cairo_paint(ctx);
+    cairo_restore(ctx);
+  } else {
+    cairo_paint_black(ctx, draw_data);
+  }
+  return 0;
+}
+
+static int cairo_paint_background(cairo_t *ctx, DrawData *draw_data,
+                                  CachedBackground **background) {
+  if (string_set_get(draw_data->image_cache, draw_data->image_path,
+                     (void **)background)) {
+    // cache miss
+    *background = load_background(draw_data);
+    if (!*background) {
+      return 1;
+    }
+    string_set_add(draw_data->image_cache, draw_data->image_path, *background);
+  }
+
+  if ((*background)->decoder) {
+    if (!cairo_paint_animation(ctx, draw_data, *background)) {
+      draw_data->animation = (*background)->animation;
+      return 0;
+    }
+    if (fall_back_to_image(*background, draw_data)) {
+      return 1;
+    }
+  }
+  draw_data->animation = 0;
+
+  cairo_surface_t *image = (*background)->image;
+  if (!image) {
+    return 1;
+  }
+
+  cairo_paint_black(ctx, draw_data);
 
   const int image_width = cairo_image_surface_get_width(image);
   const int image_height = cairo_image_surface_get_height(image);
@@ -205,22 +404,77 @@ static int cairo_paint_background(cairo_t *ctx, DrawData *draw_data) {
   cairo_paint(ctx);
   cairo_restore(ctx);
 
-  // todo: destructor for images
-  // cairo_surface_destroy(image);
   return 0;
 }
 
-static void cairo_paint_text(cairo_t *ctx, char *text, float font_size,
-                             float pos_x, float pos_y) {
-  cairo_text_extents_t extents;
+/* Derives the text style from the background pixels below the clock. Only
+ * runs once per cached background and screen size. */
+static void analyze_background(cairo_surface_t *surface,
+                               CachedBackground *background,
+                               DrawData *draw_data) {
+  if (background->analyzed_size.width == draw_data->screen_size.width &&
+      background->analyzed_size.height == draw_data->screen_size.height) {
+    return;
+  }
+
+  /* animations are analyzed on their first frame */
+  if (background->animation &&
+      !animation_current_frame(background->animation)) {
+    return;
+  }
+
+  cairo_surface_flush(surface);
+
+  int region_x = (int)draw_data->time_offset_left;
+  int region_y = draw_data->screen_size.height -
+                 (int)draw_data->time_offset_bottom - TEXT_REGION_ASCENT;
+
+  LuminanceHistogram histogram;
+  if (luminance_histogram_argb32(cairo_image_surface_get_data(surface),
+                                 cairo_image_surface_get_stride(surface),
+                                 cairo_image_surface_get_width(surface),
+                                 cairo_image_surface_get_height(surface),
+                                 region_x, region_y, TEXT_REGION_WIDTH,
+                                 TEXT_REGION_ASCENT + TEXT_REGION_DESCENT,
+                                 &histogram)) {
+    return;
+  }
+
+  background->text_style = text_style_from_histogram(&histogram);
+  background->analyzed_size = draw_data->screen_size;
+  DEBUG_PRINT("text style: contrast %.2f, decoration %d\n",
+              background->text_style.contrast,
+              background->text_style.decoration);
+}
 
+static void cairo_paint_text(cairo_t *ctx, char *text, float font_size,
+                             float pos_x, float pos_y, TextStyle *style) {
   cairo_select_font_face(ctx, "Sans", CAIRO_FONT_SLANT_NORMAL,
                          CAIRO_FONT_WEIGHT_NORMAL);
 
   cairo_set_font_size(ctx, font_size);
-  cairo_text_extents(ctx, text, &extents);
 
-  cairo_set_source_rgba(ctx, 1, 1, 1, 1);
+  switch (style->decoration) {
+  case TEXT_DECORATION_NONE:
+    break;
+  case TEXT_DECORATION_SHADOW:
+    cairo_set_source_rgba(ctx, style->decoration_red, style->decoration_green,
+                          style->decoration_blue, 0.6);
+    cairo_move_to(ctx, pos_x + font_size * 0.03f, pos_y + font_size * 0.03f);
+    cairo_show_text(ctx, text);
+    break;
+  case TEXT_DECORATION_OUTLINE:
+    cairo_set_source_rgba(ctx, style->decoration_red, style->decoration_green,
+                          style->decoration_blue, 1);
+    cairo_set_line_width(ctx, font_size * 0.06f);
+    cairo_set_line_join(ctx, CAIRO_LINE_JOIN_ROUND);
+    cairo_move_to(ctx, pos_x, pos_y);
+    cairo_text_path(ctx, text);
+    cairo_stroke(ctx);
+    break;
+  }
+
+  cairo_set_source_rgba(ctx, style->red, style->green, style->blue, 1);
   cairo_move_to(ctx, pos_x, pos_y);
   cairo_show_text(ctx, text);
 }
@@ -232,7 +486,8 @@ static void cairo_paint_text_primary(cairo_t *ctx, DrawData *draw_data) {
 
   cairo_paint_text(ctx, time_str, 100.0, draw_data->time_offset_left,
                    (float)(draw_data->screen_size.height) -
-                       draw_data->time_offset_bottom - 60.0f);
+                       draw_data->time_offset_bottom - 60.0f,
+                   &draw_data->text_style);
 }
 
 static void cairo_paint_text_secondary(cairo_t *ctx, DrawData *draw_data) {
@@ -242,23 +497,31 @@ static void cairo_paint_text_secondary(cairo_t *ctx, DrawData *draw_data) {
 
   cairo_paint_text(ctx, time_str, 50.0, draw_data->time_offset_left,
                    (float)(draw_data->screen_size.height) -
-                       draw_data->time_offset_bottom);
+                       draw_data->time_offset_bottom,
+                   &draw_data->text_style);
 }
 
 static void paint(X11Context *x11_context, cairo_t *ctx,
                   cairo_surface_t *cairo_surface, DrawData *draw_data) {
-  DEBUG_PRINT("paint\n");
-
-  /* Create a straging surface to paint to in order to prevent displaying half
-   * drawn frames */
-  cairo_surface_t *stating_surface = cairo_surface_create_similar_image(
-      cairo_surface, 0, draw_data->screen_size.width,
-      draw_data->screen_size.height);
+  /* The staging surface is kept until the screen size changes, animations
+   * paint to it for every frame */
+  if (!draw_data->staging_surface) {
+    draw_data->staging_surface = cairo_surface_create_similar_image(
+        cairo_surface, 0, draw_data->screen_size.width,
+        draw_data->screen_size.height);
+  }
+  cairo_surface_t *stating_surface = draw_data->staging_surface;
 
   cairo_t *staging_context = cairo_create(stating_surface);
 
-  if (cairo_paint_background(staging_context, draw_data)) {
+  CachedBackground *background;
+  if (cairo_paint_background(staging_context, draw_data, &background)) {
     fprintf(stderr, "unable to open image '%s'\n", draw_data->image_path);
+    cairo_paint_black(staging_context, draw_data);
+    draw_data->text_style = text_style_default();
+  } else {
+    analyze_background(stating_surface, background, draw_data);
+    draw_data->text_style = background->text_style;
   }
 
   struct timeval t;
@@ -290,8 +553,6 @@ static void paint(X11Context *x11_context, cairo_t *ctx,
                   draw_data->screen_size.height);
   cairo_fill(ctx);
 
-  cairo_surface_destroy(stating_surface);
-
   xcb_flush(x11_context->connection);
 }
 
@@ -303,6 +564,12 @@ static int process_event(X11Context *x11_context, cairo_t *cairo_context,
   case XCB_CONFIGURE_NOTIFY: {
     xcb_configure_notify_event_t *e = (xcb_configure_notify_event_t *)event;
     DEBUG_PRINT("ConfigureNotify width: %d, height: %d\n", e->width, e->height);
+    if (draw_data->staging_surface &&
+        (draw_data->screen_size.height != e->height ||
+         draw_data->screen_size.width != e->width)) {
+      cairo_surface_destroy(draw_data->staging_surface);
+      draw_data->staging_surface = 0;
+    }
     draw_data->screen_size.height = e->height;
     draw_data->screen_size.width = e->width;
     cairo_xcb_surface_set_size(cairo_surface, e->width, e->height);
@@ -312,6 +579,23 @@ static int process_event(X11Context *x11_context, cairo_t *cairo_context,
     DEBUG_PRINT("Expose\n");
     paint(x11_context, cairo_context, cairo_surface, draw_data);
     break;
+  case XCB_VISIBILITY_NOTIFY: {
+    xcb_visibility_notify_event_t *e = (xcb_visibility_notify_event_t *)event;
+    DEBUG_PRINT("VisibilityNotify state: %d\n", e->state);
+    draw_data->visible = e->state != XCB_VISIBILITY_FULLY_OBSCURED;
+    if (draw_data->animation) {
+      animation_set_visible(draw_data->animation, draw_data->visible);
+    }
+    break;
+  }
+  case XCB_MAP_NOTIFY:
+  case XCB_UNMAP_NOTIFY:
+    DEBUG_PRINT("Map/UnmapNotify\n");
+    draw_data->visible = (event->response_type & ~0x80) == XCB_MAP_NOTIFY;
+    if (draw_data->animation) {
+      animation_set_visible(draw_data->animation, draw_data->visible);
+    }
+    break;
   case XCB_BUTTON_PRESS:
     DEBUG_PRINT("ButtonPress\n");
     return 1;
@@ -326,28 +610,68 @@ static int event_loop(X11Context *x11_context, cairo_t *cairo_context,
                       cairo_surface_t *cairo_surface, DrawData *draw_data) {
   xcb_generic_event_t *event;
   int done = 0;
-  while (!done && (event = xcb_wait_for_event(x11_context->connection))) {
-    done = process_event(x11_context, cairo_context, cairo_surface, draw_data,
-                         event);
-    free(event);
+  while (!done) {
+    while (!done && (event = xcb_poll_for_event(x11_context->connection))) {
+      done = process_event(x11_context, cairo_context, cairo_surface,
+                           draw_data, event);
+      free(event);
+    }
+    if (done || xcb_connection_has_error(x11_context->connection)) {
+      break;
+    }
+
+    /* present the next animation frame once it is due, or what is left of a
+     * failed one. Painting may queue events so look for those again before
+     * waiting */
+    if (draw_data->animation && (animation_advance(draw_data->animation) ||
+                                 animation_failed(draw_data->animation))) {
+      paint(x11_context, cairo_context, cairo_surface, draw_data);
+      continue;
+    }
+
+    struct timeval timeout;
+    int wait_forever = !draw_data->animation ||
+                       animation_timeout(draw_data->animation, &timeout);
+
+    fd_set fds;
+    FD_ZERO(&fds);
+    FD_SET(x11_context->fd, &fds);
+    FD_SET(wake_pipe[0], &fds);
+    int nfds = (x11_context->fd > wake_pipe[0] ? x11_context->fd
+                                                : wake_pipe[0]) +
+               1;
+    if (select(nfds, &fds, 0, 0, wait_forever ? 0 : &timeout) <= 0 ||
+        !FD_ISSET(wake_pipe[0], &fds)) {
+      continue;
+    }
+
+    /* a decoded frame only needs the loop to run again, the clock needs a
+     * repaint */
+    char reasons[16];
+    int tick = 0;
+    ssize_t n;
+    while ((n = read(wake_pipe[0], reasons, sizeof(reasons))) > 0) {
+      for (ssize_t i = 0; i < n; i++) {
+        tick |= reasons[i] == WAKE_TICK;
+      }
+    }
+    if (tick) {
+      paint(x11_context, cairo_context, cairo_surface, draw_data);
+    }
   }
   return 0;
 }
 
-void tock() {
-  xcb_expose_event_t invalidate_event;
-  invalidate_event.window = x11_context.window;
-  invalidate_event.response_type = XCB_EXPOSE;
-  invalidate_event.x = 0;
-  invalidate_event.y = 0;
-  invalidate_event.width = 0;
-  invalidate_event.height = 0;
-  xcb_send_event(x11_context.connection, 0, x11_context.window,
-                 XCB_EVENT_MASK_EXPOSURE, (char *)&invalidate_event);
-
-  xcb_flush(x11_context.connection);
+static void wake(char reason) {
+  /* the pipe is non-blocking, a full pipe already wakes the loop */
+  ssize_t ret = write(wake_pipe[1], &reason, 1);
+  (void)ret;
 }
 
+void tock() { wake(WAKE_TICK); }
+
+static void frame_ready(void) { wake(WAKE_FRAME); }
+
 static int start_timer() {
   static timer_t timer;
   static struct sigevent sigev;
@@ -384,6 +708,10 @@ int main(int argc, char **argv) {
   // draw_data.scale_type = SCALE_TYPE_FIT;
   // draw_data.scale_type = SCALE_TYPE_CENTER;
   draw_data.scale_type = SCALE_TYPE_COVER;
+  draw_data.animation = 0;
+  draw_data.visible = 1;
+  draw_data.frame_ready = frame_ready;
+  draw_data.staging_surface = 0;
   StringSet image_cache;
   draw_data.image_cache = &image_cache;
   string_set_init(draw_data.image_cache);
@@ -396,6 +724,13 @@ int main(int argc, char **argv) {
 
   init_x11_context(&x11_context, parent_window_id);
 
+  if (pipe(wake_pipe)) {
+    fprintf(stderr, "unable to create wake pipe\n");
+    return -1;
+  }
+  fcntl(wake_pipe[0], F_SETFL, O_NONBLOCK);
+  fcntl(wake_pipe[1], F_SETFL, O_NONBLOCK);
+
   cairo_surface_t *cairo_surface;
   create_x11_surface(&cairo_surface, &x11_context, &draw_data);
 
@@ -404,7 +739,15 @@ int main(int argc, char **argv) {
   start_timer();
   event_loop(&x11_context, ctx, cairo_surface, &draw_data);
 
+  CachedBackground *background;
+  if (!string_set_remove(draw_data.image_cache, draw_data.image_path,
+                         (void **)&background)) {
+    destroy_background(background);
+  }
   string_set_destroy(draw_data.image_cache);
+  if (draw_data.staging_surface) {
+    cairo_surface_destroy(draw_data.staging_surface);
+  }
   cairo_destroy(ctx);
   cairo_close_x11_surface(cairo_surface);
 
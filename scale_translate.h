@@ -1,3 +1,6 @@
+#ifndef SCALE_TRANSLATE_H
+#define SCALE_TRANSLATE_H
+
 typedef enum _scale_type {
   SCALE_TYPE_STRETCH,
   SCALE_TYPE_FIT,
@@ -21,3 +24,5 @@ ScaleTranslate scale_stretch(int screen_width, int screen_height,
 
 ScaleTranslate translate_center(int screen_width, int screen_height,
                                        int image_width, int image_height);
+
+#endif
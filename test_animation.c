@@ -0,0 +1,196 @@
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+
+#include "animation.h"
+
+/* same 2x1 GIF as test_frame_decoder: a 50ms frame and a 100ms frame */
+static const unsigned char gif[] = {
+    'G', 'I', 'F', '8', '9', 'a', 2, 0, 1, 0, 0x81, 0, 0,
+    0, 0, 0, 255, 0, 0, 0, 255, 0, 0, 0, 255,
+    0x21, 0xf9, 4, 0x00, 5, 0, 0, 0,
+    0x2c, 0, 0, 0, 0, 2, 0, 1, 0, 0, 2, 2, 0x0c, 0x0a, 0,
+    0x21, 0xf9, 4, 0x01, 0, 0, 0, 0,
+    0x2c, 0, 0, 0, 0, 2, 0, 1, 0, 0, 2, 2, 0xc4, 0x0a, 0,
+    0x3b};
+
+/* offset of the second graphic control block */
+#define SECOND_FRAME 48
+
+static const ScaleTranslate identity = {0, 0, 1, 1};
+
+static void frame_ready(void) {}
+
+static void sleep_ms(int ms) {
+  struct timespec t = {ms / 1000, (long)(ms % 1000) * 1000000};
+  nanosleep(&t, 0);
+}
+
+/* Waits up to a second for the decoder thread to fill the ring or finish */
+static void wait_for_decoder(Animation *animation, int filled) {
+  for (int i = 0; i < 1000; i++) {
+    pthread_mutex_lock(&animation->mutex);
+    int done = animation->filled >= filled || animation->finished;
+    pthread_mutex_unlock(&animation->mutex);
+    if (done) {
+      return;
+    }
+    sleep_ms(1);
+  }
+  assert(0);
+}
+
+static void start(Animation *animation, FrameDecoder *decoder,
+                  const unsigned char *data, size_t size, int visible) {
+  assert(frame_decoder_open_memory(decoder, data, size) == 0);
+  assert(animation_init(animation, decoder, 4, 2, identity, visible,
+                        frame_ready) == 0);
+}
+
+static void stop(Animation *animation, FrameDecoder *decoder) {
+  assert(animation_destroy(animation) == 0);
+  assert(frame_decoder_destroy(decoder) == 0);
+}
+
+void test_0() {
+  Animation animation;
+  FrameDecoder decoder;
+  struct timeval timeout;
+
+  /* the first frame shows once it is decoded */
+  start(&animation, &decoder, gif, sizeof(gif), 1);
+  wait_for_decoder(&animation, 1);
+  assert(animation_current_frame(&animation) == NULL);
+  assert(animation_timeout(&animation, &timeout) == 0);
+  assert(timeout.tv_sec == 0 && timeout.tv_usec == 0);
+
+  assert(animation_advance(&animation) == 1);
+  cairo_surface_t *frame = animation_current_frame(&animation);
+  assert(frame);
+  assert(cairo_image_surface_get_width(frame) == 4);
+  assert(cairo_image_surface_get_height(frame) == 2);
+  assert(animation_failed(&animation) == 0);
+
+  stop(&animation, &decoder);
+}
+
+void test_1() {
+  Animation animation;
+  FrameDecoder decoder;
+  struct timeval timeout;
+
+  /* frames don't advance before their deadline */
+  start(&animation, &decoder, gif, sizeof(gif), 1);
+  wait_for_decoder(&animation, ANIMATION_RING_SIZE);
+  assert(animation_advance(&animation) == 1);
+  cairo_surface_t *first = animation_current_frame(&animation);
+
+  assert(animation_advance(&animation) == 0);
+  assert(animation_current_frame(&animation) == first);
+  assert(animation_timeout(&animation, &timeout) == 0);
+  assert(timeout.tv_sec == 0 && timeout.tv_usec > 0 &&
+         timeout.tv_usec <= 50000);
+
+  sleep_ms(60);
+  assert(animation_advance(&animation) == 1);
+  assert(animation_current_frame(&animation) != first);
+
+  stop(&animation, &decoder);
+}
+
+void test_2() {
+  Animation animation;
+  FrameDecoder decoder;
+  struct timeval timeout;
+
+  /* nothing is decoded while not visible */
+  start(&animation, &decoder, gif, sizeof(gif), 0);
+  sleep_ms(20);
+  assert(animation.filled == 0);
+  assert(animation_advance(&animation) == 0);
+  assert(animation_timeout(&animation, &timeout) == 1);
+
+  animation_set_visible(&animation, 1);
+  wait_for_decoder(&animation, ANIMATION_RING_SIZE);
+  assert(animation_advance(&animation) == 1);
+
+  /* and playback pauses when the window is hidden again */
+  animation_set_visible(&animation, 0);
+  cairo_surface_t *frame = animation_current_frame(&animation);
+  sleep_ms(60);
+  assert(animation_advance(&animation) == 0);
+  assert(animation_current_frame(&animation) == frame);
+  assert(animation_timeout(&animation, &timeout) == 1);
+
+  stop(&animation, &decoder);
+}
+
+void test_3() {
+  Animation animation;
+  FrameDecoder decoder;
+
+  /* a 2 frame animation starts over, frames alternate between two delays */
+  start(&animation, &decoder, gif, sizeof(gif), 1);
+  int delays = 0;
+  for (int i = 0; i < 5; i++) {
+    wait_for_decoder(&animation, 2);
+    pthread_mutex_lock(&animation.mutex);
+    int next = (animation.read + (i ? 1 : 0)) % ANIMATION_RING_SIZE;
+    delays += animation.ring[next].delay_ms;
+    pthread_mutex_unlock(&animation.mutex);
+
+    animation.deadline.tv_sec = 0;
+    assert(animation_advance(&animation) == 1);
+  }
+  assert(delays == 50 + 100 + 50 + 100 + 50);
+  assert(animation.finished == 0);
+
+  stop(&animation, &decoder);
+}
+
+void test_4() {
+  Animation animation;
+  FrameDecoder decoder;
+  struct timeval timeout;
+  unsigned char data[sizeof(gif)];
+
+  /* a single frame stays on screen without waiting for more */
+  memcpy(data, gif, SECOND_FRAME);
+  data[SECOND_FRAME] = 0x3b;
+  start(&animation, &decoder, data, SECOND_FRAME + 1, 1);
+  wait_for_decoder(&animation, 2);
+  assert(animation_advance(&animation) == 1);
+  cairo_surface_t *frame = animation_current_frame(&animation);
+  sleep_ms(60);
+  assert(animation_advance(&animation) == 0);
+  assert(animation_current_frame(&animation) == frame);
+  assert(animation_timeout(&animation, &timeout) == 1);
+  assert(animation_failed(&animation) == 0);
+  /* only the frame on screen is kept */
+  assert(animation.running == 0);
+  for (int i = 0; i < ANIMATION_RING_SIZE; i++) {
+    assert((animation.ring[i].surface == frame) == (i == animation.read));
+  }
+  stop(&animation, &decoder);
+
+  /* a corrupt first frame fails */
+  memcpy(data, gif, sizeof(gif));
+  data[SECOND_FRAME - 5] = 0;
+  start(&animation, &decoder, data, sizeof(data), 1);
+  wait_for_decoder(&animation, 1);
+  assert(animation_advance(&animation) == 0);
+  assert(animation_current_frame(&animation) == NULL);
+  assert(animation_timeout(&animation, &timeout) == 1);
+  assert(animation_failed(&animation) == 1);
+  stop(&animation, &decoder);
+}
+
+int main() {
+  test_0();
+  test_1();
+  test_2();
+  test_3();
+  test_4();
+  printf("tests OK\n");
+}
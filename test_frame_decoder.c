@@ -0,0 +1,211 @@
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+#include <zlib.h>
+
+#include "frame_decoder.h"
+
+/* 2x1 GIF with a red/black frame, followed by a frame that keeps the red
+ * pixel through transparency and paints the second one blue */
+static const unsigned char gif[] = {
+    'G', 'I', 'F', '8', '9', 'a', 2, 0, 1, 0, 0x81, 0, 0,
+    /* global color table: black, red, green, blue */
+    0, 0, 0, 255, 0, 0, 0, 255, 0, 0, 0, 255,
+    /* graphic control: 50ms */
+    0x21, 0xf9, 4, 0x00, 5, 0, 0, 0,
+    /* image 2x1: clear, 1, 0, end */
+    0x2c, 0, 0, 0, 0, 2, 0, 1, 0, 0, 2, 2, 0x0c, 0x0a, 0,
+    /* graphic control: no delay, transparent index 0 */
+    0x21, 0xf9, 4, 0x01, 0, 0, 0, 0,
+    /* image 2x1: clear, 0, 3, end */
+    0x2c, 0, 0, 0, 0, 2, 0, 1, 0, 0, 2, 2, 0xc4, 0x0a, 0,
+    /* trailer */
+    0x3b};
+
+static unsigned char apng[512];
+
+static size_t append_chunk(size_t offset, const char *type,
+                           const unsigned char *data, size_t length) {
+  unsigned char *p = apng + offset;
+  p[0] = p[1] = 0;
+  p[2] = (unsigned char)(length >> 8);
+  p[3] = (unsigned char)length;
+  memcpy(p + 4, type, 4);
+  memcpy(p + 8, data, length);
+  uLong crc = crc32(0, p + 4, (uInt)(length + 4));
+  p[8 + length] = (unsigned char)(crc >> 24);
+  p[9 + length] = (unsigned char)(crc >> 16);
+  p[10 + length] = (unsigned char)(crc >> 8);
+  p[11 + length] = (unsigned char)crc;
+  return offset + 12 + length;
+}
+
+static size_t append_frame_control(size_t offset, unsigned char sequence,
+                                   unsigned char width, unsigned char x,
+                                   unsigned char delay_num,
+                                   unsigned char blend_op) {
+  unsigned char control[26] = {0};
+  control[3] = sequence;
+  control[7] = width;
+  control[11] = 1;
+  control[15] = x;
+  control[21] = delay_num;
+  control[23] = 10;
+  control[25] = blend_op;
+  return append_chunk(offset, "fcTL", control, sizeof(control));
+}
+
+/* 2x1 APNG with an opaque red and a half transparent green pixel, followed
+ * by a frame that blends half transparent blue over the green one */
+static size_t build_apng() {
+  static const unsigned char signature[8] = {0x89, 'P',  'N',  'G',
+                                             '\r', '\n', 0x1a, '\n'};
+  unsigned char ihdr[13] = {0, 0, 0, 2, 0, 0, 0, 1, 8, 6, 0, 0, 0};
+  unsigned char actl[8] = {0, 0, 0, 2, 0, 0, 0, 0};
+  unsigned char scanline_0[9] = {0, 255, 0, 0, 255, 0, 255, 0, 128};
+  unsigned char scanline_1[5] = {0, 0, 0, 255, 128};
+  unsigned char data[64];
+  uLongf length;
+
+  memcpy(apng, signature, 8);
+  size_t offset = append_chunk(8, "IHDR", ihdr, sizeof(ihdr));
+  offset = append_chunk(offset, "acTL", actl, sizeof(actl));
+
+  offset = append_frame_control(offset, 0, 2, 0, 1, 0);
+  length = sizeof(data);
+  assert(compress(data, &length, scanline_0, sizeof(scanline_0)) == Z_OK);
+  offset = append_chunk(offset, "IDAT", data, length);
+
+  offset = append_frame_control(offset, 1, 1, 1, 0, 1);
+  length = sizeof(data) - 4;
+  memset(data, 0, 4);
+  data[3] = 2;
+  assert(compress(data + 4, &length, scanline_1, sizeof(scanline_1)) == Z_OK);
+  offset = append_chunk(offset, "fdAT", data, length + 4);
+
+  return append_chunk(offset, "IEND", data, 0);
+}
+
+void test_0() {
+  FrameDecoder decoder;
+  int delay;
+
+  assert(frame_decoder_open_memory(&decoder, gif, sizeof(gif)) == 0);
+  assert(decoder.width == 2 && decoder.height == 1);
+
+  assert(frame_decoder_next(&decoder, &delay) == 0);
+  assert(delay == 50);
+  assert(decoder.canvas[0] == 0xffff0000);
+  assert(decoder.canvas[1] == 0xff000000);
+
+  assert(frame_decoder_next(&decoder, &delay) == 0);
+  assert(delay == 100);
+  assert(decoder.canvas[0] == 0xffff0000);
+  assert(decoder.canvas[1] == 0xff0000ff);
+
+  assert(frame_decoder_next(&decoder, &delay) == 1);
+  assert(decoder.previous == NULL);
+
+  assert(frame_decoder_rewind(&decoder) == 0);
+  assert(frame_decoder_next(&decoder, &delay) == 0);
+  assert(decoder.canvas[1] == 0xff000000);
+
+  assert(frame_decoder_destroy(&decoder) == 0);
+}
+
+void test_1() {
+  FrameDecoder decoder;
+  int delay;
+
+  size_t size = build_apng();
+  assert(frame_decoder_open_memory(&decoder, apng, size) == 0);
+  assert(decoder.width == 2 && decoder.height == 1);
+
+  assert(frame_decoder_next(&decoder, &delay) == 0);
+  assert(delay == 100);
+  assert(decoder.canvas[0] == 0xffff0000);
+  assert(decoder.canvas[1] == 0x80008000);
+
+  assert(frame_decoder_next(&decoder, &delay) == 0);
+  assert(delay == 10);
+  assert(decoder.canvas[0] == 0xffff0000);
+  assert(decoder.canvas[1] == 0xc0004080);
+
+  assert(frame_decoder_next(&decoder, &delay) == 1);
+
+  assert(frame_decoder_destroy(&decoder) == 0);
+}
+
+void test_2() {
+  FrameDecoder decoder;
+
+  /* a PNG without animation control is left to cairo */
+  size_t size = build_apng();
+  memcpy(apng + 8 + 25 + 4, "tEXt", 4);
+  assert(frame_decoder_open_memory(&decoder, apng, size) == 1);
+
+  assert(frame_decoder_open_memory(&decoder, gif, 6) == 1);
+}
+
+void test_3() {
+  FrameDecoder decoder;
+  int delay;
+  unsigned char corrupt[sizeof(gif)];
+
+  /* canvas too large */
+  memcpy(corrupt, gif, sizeof(gif));
+  corrupt[7] = corrupt[9] = 0xff;
+  assert(frame_decoder_open_memory(&decoder, corrupt, sizeof(corrupt)) == 1);
+
+  /* frames reaching past the canvas are clipped */
+  memcpy(corrupt, gif, sizeof(gif));
+  corrupt[13 + 12 + 8 + 5] = 0xff;
+  corrupt[13 + 12 + 8 + 6] = 0xff;
+  corrupt[13 + 12 + 8 + 7] = 0xff;
+  corrupt[13 + 12 + 8 + 8] = 0xff;
+  assert(frame_decoder_open_memory(&decoder, corrupt, sizeof(corrupt)) == 0);
+  assert(frame_decoder_next(&decoder, &delay) == 0);
+  assert(decoder.canvas[0] == 0xffff0000);
+  assert(decoder.canvas[1] == 0xff000000);
+  assert(frame_decoder_next(&decoder, &delay) == 0);
+  assert(decoder.canvas[1] == 0xff0000ff);
+  assert(frame_decoder_destroy(&decoder) == 0);
+
+  /* unless they would have to be decoded in full to get there */
+  corrupt[13 + 12 + 8 + 9] = 0x40;
+  assert(frame_decoder_open_memory(&decoder, corrupt, sizeof(corrupt)) == 0);
+  assert(frame_decoder_next(&decoder, &delay) == -1);
+  assert(frame_decoder_destroy(&decoder) == 0);
+}
+
+void test_4() {
+  FrameDecoder decoder;
+  int delay;
+  unsigned char data[sizeof(gif)];
+
+  /* the first frame is disposed to the empty canvas before the second one */
+  memcpy(data, gif, sizeof(gif));
+  data[13 + 12 + 3] = 0x0c;
+  assert(frame_decoder_open_memory(&decoder, data, sizeof(data)) == 0);
+  assert(decoder.previous == NULL);
+
+  assert(frame_decoder_next(&decoder, &delay) == 0);
+  assert(decoder.previous != NULL);
+  assert(decoder.canvas[0] == 0xffff0000);
+
+  assert(frame_decoder_next(&decoder, &delay) == 0);
+  assert(decoder.canvas[0] == 0);
+  assert(decoder.canvas[1] == 0xff0000ff);
+
+  assert(frame_decoder_destroy(&decoder) == 0);
+}
+
+int main() {
+  test_0();
+  test_1();
+  test_2();
+  test_3();
+  test_4();
+  printf("tests OK\n");
+}
@@ -0,0 +1,87 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <assert.h>
+
+#include "text_style.h"
+
+#define WIDTH 8
+#define HEIGHT 4
+
+static uint32_t pixels[WIDTH * HEIGHT];
+
+static void fill(uint32_t color) {
+  for (int i = 0; i < WIDTH * HEIGHT; i++) {
+    pixels[i] = color;
+  }
+}
+
+static TextStyle analyze(int x, int y, int width, int height) {
+  LuminanceHistogram histogram;
+  assert(luminance_histogram_argb32((const unsigned char *)pixels,
+                                    WIDTH * sizeof(uint32_t), WIDTH, HEIGHT, x,
+                                    y, width, height, &histogram) == 0);
+  return text_style_from_histogram(&histogram);
+}
+
+void test_0() {
+  LuminanceHistogram histogram;
+  fill(0xff000000);
+  pixels[0] = 0xffffffff;
+  assert(luminance_histogram_argb32((const unsigned char *)pixels,
+                                    WIDTH * sizeof(uint32_t), WIDTH, HEIGHT,
+                                    -2, -2, 4, 4, &histogram) == 0);
+  assert(histogram.pixel_count == 4);
+  assert(histogram.bins[255] == 1);
+  assert(histogram.bins[0] == 3);
+
+  assert(luminance_histogram_argb32((const unsigned char *)pixels,
+                                    WIDTH * sizeof(uint32_t), WIDTH, HEIGHT,
+                                    WIDTH, 0, 4, 4, &histogram) == 0);
+  assert(histogram.pixel_count == 0);
+}
+
+void test_1() {
+  fill(0xff000000);
+  TextStyle style = analyze(0, 0, WIDTH, HEIGHT);
+  assert(style.red == 1. && style.green == 1. && style.blue == 1.);
+  assert(style.decoration == TEXT_DECORATION_NONE);
+
+  fill(0xffffffff);
+  style = analyze(0, 0, WIDTH, HEIGHT);
+  assert(style.red == 0. && style.green == 0. && style.blue == 0.);
+  assert(style.decoration == TEXT_DECORATION_NONE);
+}
+
+void test_2() {
+  /* a plain background always has enough contrast to one of the colors */
+  fill(0xff808080);
+  TextStyle style = analyze(0, 0, WIDTH, HEIGHT);
+  assert(style.red == 0.);
+  assert(style.decoration == TEXT_DECORATION_NONE);
+
+  /* dark background with a gray spot below the text */
+  fill(0xff000000);
+  for (int i = 0; i < WIDTH; i++) {
+    pixels[i] = 0xff808080;
+  }
+  style = analyze(0, 0, WIDTH, HEIGHT);
+  assert(style.red == 1.);
+  assert(style.decoration == TEXT_DECORATION_SHADOW);
+  assert(style.decoration_red == 0.);
+
+  /* dark background with a bright spot below the text */
+  fill(0xff000000);
+  for (int i = 0; i < WIDTH; i++) {
+    pixels[i] = 0xffffffff;
+  }
+  style = analyze(0, 0, WIDTH, HEIGHT);
+  assert(style.red == 1.);
+  assert(style.decoration == TEXT_DECORATION_OUTLINE);
+}
+
+int main() {
+  test_0();
+  test_1();
+  test_2();
+  printf("tests OK\n");
+}
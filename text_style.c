@@ -0,0 +1,147 @@
+#include "text_style.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* minimum contrast ratios (WCAG) below which the text gets a decoration */
+#define CONTRAST_PLAIN 4.5
+#define CONTRAST_SHADOW 2.0
+
+/* percentiles of the region that the text has to stand out against */
+#define PERCENTILE_DARK 0.05
+#define PERCENTILE_BRIGHT 0.95
+
+/* Converts one row of premultiplied ARGB32 pixels to 8 bit luma using the
+ * Rec. 709 weights in 8.8 fixed point. The loop is branch free so that the
+ * compiler can vectorize it. */
+static void luma_row(const uint32_t *restrict pixels, uint8_t *restrict luma,
+                     int width) {
+  for (int i = 0; i < width; i++) {
+    uint32_t p = pixels[i];
+    uint32_t r = (p >> 16) & 0xff;
+    uint32_t g = (p >> 8) & 0xff;
+    uint32_t b = p & 0xff;
+    luma[i] = (uint8_t)((54 * r + 183 * g + 19 * b + 128) >> 8);
+  }
+}
+
+int luminance_histogram_argb32(const unsigned char *data, int stride,
+                               int data_width, int data_height, int x, int y,
+                               int width, int height,
+                               LuminanceHistogram *histogram) {
+  memset(histogram, 0, sizeof(LuminanceHistogram));
+
+  /* clip the region to the buffer */
+  if (x < 0) {
+    width += x;
+    x = 0;
+  }
+  if (y < 0) {
+    height += y;
+    y = 0;
+  }
+  if (x + width > data_width) {
+    width = data_width - x;
+  }
+  if (y + height > data_height) {
+    height = data_height - y;
+  }
+  if (width <= 0 || height <= 0) {
+    return 0;
+  }
+
+  uint8_t *luma = malloc((size_t)width);
+  if (!luma) {
+    return 1;
+  }
+
+  for (int row = y; row < y + height; row++) {
+    const uint32_t *pixels =
+        (const uint32_t *)(data + (size_t)row * (size_t)stride) + x;
+    luma_row(pixels, luma, width);
+    for (int i = 0; i < width; i++) {
+      histogram->bins[luma[i]]++;
+    }
+  }
+  histogram->pixel_count = (uint32_t)width * (uint32_t)height;
+
+  free(luma);
+  return 0;
+}
+
+static double luma_to_linear(int luma) {
+  double c = luma / 255.0;
+  if (c <= 0.04045) {
+    return c / 12.92;
+  }
+  return pow((c + 0.055) / 1.055, 2.4);
+}
+
+static double contrast_ratio(double a, double b) {
+  if (a < b) {
+    double t = a;
+    a = b;
+    b = t;
+  }
+  return (a + 0.05) / (b + 0.05);
+}
+
+static int histogram_percentile(const LuminanceHistogram *histogram,
+                                double percentile) {
+  uint32_t threshold = (uint32_t)(percentile * histogram->pixel_count);
+  uint32_t sum = 0;
+  for (int i = 0; i < LUMINANCE_HISTOGRAM_BINS; i++) {
+    sum += histogram->bins[i];
+    if (sum > threshold) {
+      return i;
+    }
+  }
+  return LUMINANCE_HISTOGRAM_BINS - 1;
+}
+
+TextStyle text_style_default(void) {
+  TextStyle ret;
+
+  ret.red = ret.green = ret.blue = 1.;
+  ret.decoration = TEXT_DECORATION_NONE;
+  ret.decoration_red = ret.decoration_green = ret.decoration_blue = 0.;
+  ret.contrast = contrast_ratio(1., 0.);
+
+  return ret;
+}
+
+TextStyle text_style_from_histogram(const LuminanceHistogram *histogram) {
+  TextStyle ret = text_style_default();
+
+  if (histogram->pixel_count == 0) {
+    return ret;
+  }
+
+  double median = luma_to_linear(histogram_percentile(histogram, 0.5));
+  int light_text = contrast_ratio(1., median) >= contrast_ratio(0., median);
+
+  /* the worst case is the part of the background closest to the text color */
+  double worst;
+  if (light_text) {
+    worst = luma_to_linear(histogram_percentile(histogram, PERCENTILE_BRIGHT));
+    ret.contrast = contrast_ratio(1., worst);
+  } else {
+    worst = luma_to_linear(histogram_percentile(histogram, PERCENTILE_DARK));
+    ret.contrast = contrast_ratio(0., worst);
+  }
+
+  double text = light_text ? 1. : 0.;
+  ret.red = ret.green = ret.blue = text;
+  ret.decoration_red = ret.decoration_green = ret.decoration_blue = 1. - text;
+
+  if (ret.contrast >= CONTRAST_PLAIN) {
+    ret.decoration = TEXT_DECORATION_NONE;
+  } else if (ret.contrast >= CONTRAST_SHADOW) {
+    ret.decoration = TEXT_DECORATION_SHADOW;
+  } else {
+    ret.decoration = TEXT_DECORATION_OUTLINE;
+  }
+
+  return ret;
+}
@@ -0,0 +1,45 @@
+#ifndef TEXT_STYLE_H
+#define TEXT_STYLE_H
+
+#include <stdint.h>
+
+#define LUMINANCE_HISTOGRAM_BINS 256
+
+typedef enum _text_decoration {
+  TEXT_DECORATION_NONE,
+  TEXT_DECORATION_SHADOW,
+  TEXT_DECORATION_OUTLINE
+} text_decoration_t;
+
+typedef struct {
+  uint32_t bins[LUMINANCE_HISTOGRAM_BINS];
+  uint32_t pixel_count;
+} LuminanceHistogram;
+
+typedef struct {
+  double red;
+  double green;
+  double blue;
+  text_decoration_t decoration;
+  double decoration_red;
+  double decoration_green;
+  double decoration_blue;
+  /* WCAG contrast ratio between the text color and the brightest (or darkest)
+   * part of the analyzed region, between 1 and 21 */
+  double contrast;
+} TextStyle;
+
+/* Builds the luminance histogram of the rectangle (x, y, width, height) of an
+ * ARGB32 pixel buffer. The rectangle is clipped to the buffer dimensions. */
+int luminance_histogram_argb32(const unsigned char *data, int stride,
+                               int data_width, int data_height, int x, int y,
+                               int width, int height,
+                               LuminanceHistogram *histogram);
+
+/* Picks a text color and decoration that stay readable on a background with
+ * the given luminance histogram. */
+TextStyle text_style_from_histogram(const LuminanceHistogram *histogram);
+
+TextStyle text_style_default(void);
+
+#endif